@@ -0,0 +1,155 @@
+/*
+ *  Copyright (C) 2020  Marek Marecki
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef STREAM_BUFFER_CAPI_H
+#define STREAM_BUFFER_CAPI_H
+
+/*
+ * C interface to libstream-buffer. Lets programs buffer their own output
+ * in-process, with the same semantics as piping it through stream-buffer(1).
+ *
+ * Functions returning int or ssize_t return -1 and set errno on failure.
+ * Functions returning a pointer return NULL and set errno on failure.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * The library is built with hidden visibility; only what is declared here is
+ * exported.
+ */
+#if defined(__GNUC__)
+#pragma GCC visibility push(default)
+#endif
+
+typedef struct stream_buffer stream_buffer;
+
+/*
+ * Sink receives flushed data and returns the number of bytes it consumed. If
+ * that is less than it was given it is called again with the rest. Returning 0
+ * or -1 reports an error; the data that was not consumed is then discarded and
+ * the flushing call returns -1. A sink returning -1 should set errno; for 0 it
+ * is set to EIO.
+ */
+typedef ssize_t (*stream_buffer_sink)(void* context,
+                                      uint8_t const* data,
+                                      size_t size);
+
+enum stream_buffer_filter {
+    /* Let through only records containing the text... */
+    STREAM_BUFFER_INCLUDE = 0,
+    /* ...or starting with it. */
+    STREAM_BUFFER_INCLUDE_PREFIX = 1,
+    /* Drop records containing the text... */
+    STREAM_BUFFER_EXCLUDE = 2,
+    /* ...or starting with it. */
+    STREAM_BUFFER_EXCLUDE_PREFIX = 3,
+};
+
+enum stream_buffer_framing {
+    /* Flush only when the buffer is full, or explicitly. */
+    STREAM_BUFFER_FRAMING_NONE = 0,
+    /* Also flush complete, newline-terminated lines. */
+    STREAM_BUFFER_FRAMING_LINE = 1,
+    /* Also flush complete records terminated by a custom delimiter. */
+    STREAM_BUFFER_FRAMING_RECORD = 2,
+};
+
+char const* stream_buffer_version(void);
+
+/*
+ * New buffers write to standard output until given another sink. Size specs
+ * use the same format as stream-buffer(1), eg "64KiB". Destroying a buffer
+ * flushes whatever data it still holds.
+ */
+stream_buffer* stream_buffer_create(size_t size);
+stream_buffer* stream_buffer_create_from_spec(char const* size_spec);
+void stream_buffer_destroy(stream_buffer* sb);
+
+/*
+ * A NULL sink discards flushed data.
+ */
+void stream_buffer_set_sink(stream_buffer* sb,
+                            stream_buffer_sink sink,
+                            void* context);
+void stream_buffer_set_sink_fd(stream_buffer* sb, int fd);
+int stream_buffer_set_framing(stream_buffer* sb,
+                              enum stream_buffer_framing framing,
+                              int delimiter);
+
+/*
+ * Collapse runs of identical records into one record followed by a "last
+ * record repeated N times" marker. Has effect only with line or record
+ * framing. Within a run that does not break, a marker is also written after
+ * every marker_every repetitions and once marker_interval_ms milliseconds have
+ * passed since the last one; zero disables either bound. Changing the bounds
+ * keeps the current run; disabling coalescing writes its pending marker.
+ * Enabling it fails with EINVAL on an unbuffered (zero capacity) buffer.
+ *
+ * Call stream_buffer_tick() periodically to write the marker of a run that
+ * went quiet.
+ */
+int stream_buffer_set_coalescing(stream_buffer* sb,
+                                 int enabled,
+                                 size_t marker_every,
+                                 uint32_t marker_interval_ms);
+ssize_t stream_buffer_tick(stream_buffer* sb);
+
+/*
+ * Drop unwanted records before they are buffered. A record is dropped if it
+ * matches any exclude filter, or if there are include filters and it matches
+ * none of them. Has effect only with line or record framing. Fails with EINVAL
+ * on an unbuffered (zero capacity) buffer.
+ *
+ * stream_buffer_filter_stats() reports the number of records let through and
+ * dropped so far; either pointer may be NULL.
+ */
+int stream_buffer_add_filter(stream_buffer* sb,
+                             enum stream_buffer_filter kind,
+                             char const* text);
+void stream_buffer_filter_stats(stream_buffer const* sb,
+                                uint64_t* passed,
+                                uint64_t* dropped);
+
+ssize_t stream_buffer_append(stream_buffer* sb,
+                             void const* data,
+                             size_t size);
+ssize_t stream_buffer_flush(stream_buffer* sb);
+
+/*
+ * Flushes the buffer before resizing it. Resizing to zero fails with EINVAL
+ * while filters or coalescing are set.
+ */
+ssize_t stream_buffer_resize(stream_buffer* sb, size_t size);
+
+size_t stream_buffer_size(stream_buffer const* sb);
+size_t stream_buffer_capacity(stream_buffer const* sb);
+
+#if defined(__GNUC__)
+#pragma GCC visibility pop
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -17,7 +17,11 @@
 #ifndef STREAM_BUFFER_DATA_H
 #define STREAM_BUFFER_DATA_H
 
+#include <sys/types.h>
+
+#include <chrono>
 #include <cstdint>
+#include <functional>
 #include <map>
 #include <optional>
 #include <string>
@@ -47,15 +51,207 @@ struct Buffer {
     auto full() const -> bool;
 
     auto head() -> char_type*;
+    auto data() -> char_type*;
+    auto data() const -> char_type const*;
 
     auto drain() -> buffer_type;
-    auto get_line(char_type const) -> std::optional<buffer_type>;
+    auto clear() -> void;
+    auto consume(size_type const) -> void;
+    auto find_last(char_type const, size_type const) const
+        -> std::optional<size_type>;
 
     auto grow(size_type const) -> void;
     auto resize(size_type const) -> size_type;
 };
 
 
+/*
+ * Coalescer collapses runs of identical records into the first record of the
+ * run followed by a "last record repeated N times" marker. The marker is
+ * written when the run is broken, when the stream is flushed or ticks, and
+ * also within a run after every `every` repetitions or `interval` of time
+ * (whichever is set, and comes first) so that a run that never breaks is still
+ * accounted for.
+ *
+ * Only the last record is remembered, and its storage is reused, so no
+ * allocation is done per record. The records themselves are never copied out:
+ * feed() only tells whether a record is to be written, and appends the marker
+ * that has to go before it (if any) to the given buffer.
+ */
+struct Coalescer {
+    using char_type   = Buffer::char_type;
+    using buffer_type = Buffer::buffer_type;
+    using size_type   = Buffer::size_type;
+    using clock_type  = std::chrono::steady_clock;
+
+    struct Limits {
+        size_type every{0};
+        std::chrono::milliseconds interval{0};
+    };
+
+  private:
+    buffer_type last;
+    bool seen{false};
+    size_type repeated{0};
+    clock_type::time_point since;
+    Limits limits;
+
+    auto mark(buffer_type&, char_type const) -> void;
+
+  public:
+    Coalescer(Limits const);
+
+    auto limit(Limits const) -> void;
+
+    auto feed(char_type const*,
+              size_type const,
+              buffer_type&,
+              char_type const) -> bool;
+    auto finish(buffer_type&, char_type const) -> void;
+    auto reset() -> void;
+};
+
+
+/*
+ * Filter decides which records are let through. A record is dropped if it
+ * matches any exclude pattern, or if there are include patterns and it matches
+ * none of them. Patterns are literals matched either anywhere in the record or
+ * only at its start.
+ *
+ * A record that is flushed in pieces (because it does not fit in the buffer,
+ * or the buffer was flushed on request) is judged, and counted, by its first
+ * piece. The verdict is applied to the following pieces until the record ends.
+ */
+struct Filter {
+    using char_type = Buffer::char_type;
+    using size_type = Buffer::size_type;
+
+    enum class Anchor : uint8_t {
+        Anywhere,
+        Prefix,
+    };
+    struct Pattern {
+        std::string text;
+        Anchor anchor;
+    };
+
+  private:
+    std::vector<Pattern> includes;
+    std::vector<Pattern> excludes;
+    uint64_t passed_count{0};
+    uint64_t dropped_count{0};
+    std::optional<bool> unfinished;
+
+    auto judge(char_type const*, size_type const) -> bool;
+
+  public:
+    auto include(std::string, Anchor const) -> void;
+    auto exclude(std::string, Anchor const) -> void;
+    auto empty() const -> bool;
+
+    auto accept(char_type const*, size_type const) -> bool;
+    auto accept_partial(char_type const*, size_type const) -> bool;
+
+    auto passed() const -> uint64_t;
+    auto dropped() const -> uint64_t;
+};
+
+
+/*
+ * A Stream couples a Buffer with a flush policy and an output sink. This is
+ * what the stream-buffer(1) program uses internally, and what the C API
+ * exposed in <stream-buffer/capi.h> wraps for in-process use.
+ *
+ * Data is always flushed when the buffer becomes full. If a delimiter is set
+ * the Stream also flushes every complete record (ie, everything up to and
+ * including the last delimiter) as soon as it is committed.
+ *
+ * An unbuffered Stream (one with zero capacity) passes data straight to the
+ * sink, so it cannot filter or coalesce records. Trying to set that up throws
+ * std::invalid_argument.
+ */
+struct Stream {
+    using char_type = Buffer::char_type;
+    using size_type = Buffer::size_type;
+    using sink_type = std::function<ssize_t(char_type const*, size_type)>;
+
+  private:
+    Buffer buffer;
+    bool broken{false};
+    std::optional<char_type> delimiter;
+    std::optional<Filter> filter;
+    std::optional<Coalescer> coalescer;
+    Buffer::buffer_type output;
+    sink_type sink;
+
+    auto deliver(char_type const*, size_type const) -> ssize_t;
+    auto emit(size_type const) -> ssize_t;
+    auto emit_output() -> ssize_t;
+    auto processed() const -> bool;
+    auto process(size_type const) -> ssize_t;
+    auto records(size_type const) -> ssize_t;
+
+  public:
+    Stream(size_type const, sink_type);
+
+    auto sink_to(sink_type) -> void;
+    auto frame(std::optional<char_type> const) -> void;
+    auto coalesce(std::optional<Coalescer::Limits> const) -> void;
+    auto filter_by(std::optional<Filter>) -> void;
+    auto filtered() const -> std::optional<Filter> const&;
+
+    auto left() const -> size_type;
+    auto size() const -> size_type;
+    auto capacity() const -> size_type;
+
+    /*
+     * Use head() and left() to read(2) directly into the buffer, and then
+     * commit() the amount of data that was read. This avoids an extra copy.
+     */
+    auto head() -> char_type*;
+    auto commit(size_type const) -> ssize_t;
+
+    auto append(char_type const*, size_type const) -> ssize_t;
+    auto flush() -> ssize_t;
+    auto tick() -> ssize_t;
+    auto resize(size_type const) -> ssize_t;
+};
+
+auto fd_sink(int const) -> Stream::sink_type;
+
+
+/*
+ * Source holds the partial record of one producer when several of them are
+ * merged into a single Stream. Only complete records are forwarded, so records
+ * from different producers never interleave.
+ *
+ * A record that does not fit in the Source is forwarded in pieces. Until its
+ * last piece is forwarded the Source is partial(), and nothing else may be
+ * appended to the Stream in the meantime.
+ */
+struct Source {
+    using char_type = Buffer::char_type;
+    using size_type = Buffer::size_type;
+
+  private:
+    Buffer pending;
+    char_type delimiter;
+    bool unfinished{false};
+
+    auto forward(size_type const, Stream&) -> ssize_t;
+
+  public:
+    Source(size_type const, char_type const);
+
+    auto left() const -> size_type;
+    auto head() -> char_type*;
+    auto partial() const -> bool;
+    auto commit(size_type const, Stream&) -> ssize_t;
+    auto finish(Stream&) -> ssize_t;
+    auto resize(size_type const) -> void;
+};
+
+
 enum class Unit : uint8_t {
     B = 1,
     KB,
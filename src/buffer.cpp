@@ -19,6 +19,7 @@
 
 #include <algorithm>
 #include <cstdint>
+#include <cstring>
 #include <vector>
 
 
@@ -45,6 +46,14 @@ auto Buffer::head() -> char_type*
 {
     return (buffer.data() + level);
 }
+auto Buffer::data() -> char_type*
+{
+    return buffer.data();
+}
+auto Buffer::data() const -> char_type const*
+{
+    return buffer.data();
+}
 auto Buffer::drain() -> buffer_type
 {
     auto x = std::move(buffer);
@@ -56,27 +65,35 @@ auto Buffer::drain() -> buffer_type
 
     return x;
 }
-auto Buffer::get_line(char_type const delimiter) -> std::optional<buffer_type>
+auto Buffer::clear() -> void
 {
-    auto const pos = std::find(buffer.begin(), buffer.end(), delimiter);
-    if (pos == buffer.end()) {
-        return {};
+    level = 0;
+}
+auto Buffer::consume(size_type const n) -> void
+{
+    if (n >= level) {
+        level = 0;
+        return;
     }
 
-    auto line = buffer_type{};
-    line.reserve(pos - buffer.begin());
-    std::copy(buffer.begin(), pos, std::back_inserter(line));
-
-    auto rest = buffer_type{};
-    rest.reserve(buffer.capacity());
-    std::copy(pos + 1, buffer.begin() + size(), std::back_inserter(rest));
-
-    level = rest.size();
-    rest.resize(buffer.capacity());
-
-    buffer = std::move(rest);
-
-    return line;
+    std::memmove(buffer.data(), buffer.data() + n, level - n);
+    level -= n;
+}
+auto Buffer::find_last(char_type const delimiter, size_type const from) const
+    -> std::optional<size_type>
+{
+    /*
+     * Only the [from, level) range is searched. Callers pass the start of
+     * the data they have just committed when they know there is no delimiter
+     * before it, so that a long record arriving in small pieces is not
+     * scanned over and over again.
+     */
+    for (auto i = level; i > from; --i) {
+        if (buffer[i - 1] == delimiter) {
+            return (i - 1);
+        }
+    }
+    return {};
 }
 auto Buffer::grow(size_type const n) -> void
 {
@@ -90,6 +107,7 @@ auto Buffer::resize(size_type const n) -> size_type
     buffer.reserve(n);
     buffer.resize(n);
     buffer.shrink_to_fit();
+    level = 0;
 
     return old_capacity;
 }
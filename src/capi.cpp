@@ -0,0 +1,216 @@
+/*
+ *  Copyright (C) 2020  Marek Marecki
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <errno.h>
+
+#include <chrono>
+#include <cstdint>
+#include <new>
+#include <stdexcept>
+#include <utility>
+
+// FIXME do not group custom includes with POSIX and C library includes
+// clang-format off
+#include <stream-buffer/stream-buffer.h>
+#include <stream-buffer/capi.h>
+// clang-format on
+
+
+struct stream_buffer {
+    Stream_buffer::Stream stream;
+};
+
+/*
+ * No exception may cross the C boundary. Report them through errno instead.
+ */
+template<typename T, typename Fn>
+static auto guarded(T const fail, Fn&& fn) -> T
+{
+    try {
+        return fn();
+    } catch (std::bad_alloc const&) {
+        errno = ENOMEM;
+    } catch (std::exception const&) {
+        errno = EINVAL;
+    }
+    return fail;
+}
+
+extern "C" {
+char const* stream_buffer_version(void)
+{
+    return Stream_buffer::VERSION;
+}
+
+stream_buffer* stream_buffer_create(size_t const size)
+{
+    return guarded<stream_buffer*>(nullptr, [size] {
+        return new stream_buffer{
+            Stream_buffer::Stream{size, Stream_buffer::fd_sink(1)}};
+    });
+}
+stream_buffer* stream_buffer_create_from_spec(char const* const size_spec)
+{
+    if (size_spec == nullptr) {
+        errno = EINVAL;
+        return nullptr;
+    }
+    return guarded<stream_buffer*>(nullptr, [size_spec] {
+        return stream_buffer_create(
+            Stream_buffer::parse_buffer_size(size_spec));
+    });
+}
+void stream_buffer_destroy(stream_buffer* const sb)
+{
+    if (sb == nullptr) {
+        return;
+    }
+    guarded<ssize_t>(-1, [sb] { return sb->stream.flush(); });
+    delete sb;
+}
+
+void stream_buffer_set_sink(stream_buffer* const sb,
+                            stream_buffer_sink const sink,
+                            void* const context)
+{
+    if (sink == nullptr) {
+        sb->stream.sink_to(nullptr);
+        return;
+    }
+    sb->stream.sink_to([sink, context](uint8_t const* data, size_t const n) {
+        return sink(context, data, n);
+    });
+}
+void stream_buffer_set_sink_fd(stream_buffer* const sb, int const fd)
+{
+    sb->stream.sink_to(Stream_buffer::fd_sink(fd));
+}
+int stream_buffer_set_framing(stream_buffer* const sb,
+                              enum stream_buffer_framing const framing,
+                              int const delimiter)
+{
+    switch (framing) {
+    case STREAM_BUFFER_FRAMING_NONE:
+        sb->stream.frame(std::nullopt);
+        return 0;
+    case STREAM_BUFFER_FRAMING_LINE:
+        sb->stream.frame('\n');
+        return 0;
+    case STREAM_BUFFER_FRAMING_RECORD:
+        if (delimiter < 0 or delimiter > UINT8_MAX) {
+            break;
+        }
+        sb->stream.frame(static_cast<uint8_t>(delimiter));
+        return 0;
+    default:
+        break;
+    }
+    errno = EINVAL;
+    return -1;
+}
+int stream_buffer_set_coalescing(stream_buffer* const sb,
+                                 int const enabled,
+                                 size_t const marker_every,
+                                 uint32_t const marker_interval_ms)
+{
+    using Stream_buffer::Coalescer;
+    if (not enabled) {
+        return guarded<int>(-1, [sb] {
+            sb->stream.coalesce(std::nullopt);
+            return 0;
+        });
+    }
+    return guarded<int>(-1, [sb, marker_every, marker_interval_ms] {
+        sb->stream.coalesce(Coalescer::Limits{
+            marker_every, std::chrono::milliseconds{marker_interval_ms}});
+        return 0;
+    });
+}
+ssize_t stream_buffer_tick(stream_buffer* const sb)
+{
+    return guarded<ssize_t>(-1, [sb] { return sb->stream.tick(); });
+}
+int stream_buffer_add_filter(stream_buffer* const sb,
+                             enum stream_buffer_filter const kind,
+                             char const* const text)
+{
+    if (text == nullptr) {
+        errno = EINVAL;
+        return -1;
+    }
+    return guarded<int>(-1, [sb, kind, text] {
+        using Stream_buffer::Filter;
+        auto filter = sb->stream.filtered().value_or(Filter{});
+        switch (kind) {
+        case STREAM_BUFFER_INCLUDE:
+            filter.include(text, Filter::Anchor::Anywhere);
+            break;
+        case STREAM_BUFFER_INCLUDE_PREFIX:
+            filter.include(text, Filter::Anchor::Prefix);
+            break;
+        case STREAM_BUFFER_EXCLUDE:
+            filter.exclude(text, Filter::Anchor::Anywhere);
+            break;
+        case STREAM_BUFFER_EXCLUDE_PREFIX:
+            filter.exclude(text, Filter::Anchor::Prefix);
+            break;
+        default:
+            errno = EINVAL;
+            return -1;
+        }
+        sb->stream.filter_by(std::move(filter));
+        return 0;
+    });
+}
+void stream_buffer_filter_stats(stream_buffer const* const sb,
+                                uint64_t* const passed,
+                                uint64_t* const dropped)
+{
+    auto const& filter = sb->stream.filtered();
+    if (passed != nullptr) {
+        *passed = filter ? filter->passed() : 0;
+    }
+    if (dropped != nullptr) {
+        *dropped = filter ? filter->dropped() : 0;
+    }
+}
+
+ssize_t stream_buffer_append(stream_buffer* const sb,
+                             void const* const data,
+                             size_t const size)
+{
+    return guarded<ssize_t>(-1, [sb, data, size] {
+        return sb->stream.append(static_cast<uint8_t const*>(data), size);
+    });
+}
+ssize_t stream_buffer_flush(stream_buffer* const sb)
+{
+    return guarded<ssize_t>(-1, [sb] { return sb->stream.flush(); });
+}
+ssize_t stream_buffer_resize(stream_buffer* const sb, size_t const size)
+{
+    return guarded<ssize_t>(-1, [sb, size] { return sb->stream.resize(size); });
+}
+
+size_t stream_buffer_size(stream_buffer const* const sb)
+{
+    return sb->stream.size();
+}
+size_t stream_buffer_capacity(stream_buffer const* const sb)
+{
+    return sb->stream.capacity();
+}
+}
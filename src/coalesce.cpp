@@ -0,0 +1,84 @@
+/*
+ *  Copyright (C) 2020  Marek Marecki
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+// FIXME do not group custom includes with POSIX and C library includes
+// clang-format off
+#include <stream-buffer/stream-buffer.h>
+// clang-format on
+
+
+namespace Stream_buffer {
+Coalescer::Coalescer(Limits const l) : limits{l}
+{}
+auto Coalescer::limit(Limits const l) -> void
+{
+    limits = l;
+}
+auto Coalescer::mark(buffer_type& out, char_type const delimiter) -> void
+{
+    auto const marker =
+        "last record repeated " + std::to_string(repeated) + " times";
+    out.insert(out.end(), marker.begin(), marker.end());
+    out.push_back(delimiter);
+    repeated = 0;
+}
+auto Coalescer::feed(char_type const* record,
+                     size_type const n,
+                     buffer_type& out,
+                     char_type const delimiter) -> bool
+{
+    if (seen and n == last.size()
+        and (n == 0 or std::memcmp(record, last.data(), n) == 0)) {
+        auto const now = (limits.interval.count() != 0)
+                             ? clock_type::now()
+                             : clock_type::time_point{};
+        if (repeated++ == 0) {
+            since = now;
+        }
+
+        if (limits.every != 0 and repeated == limits.every) {
+            mark(out, delimiter);
+        } else if (limits.interval.count() != 0
+                   and (now - since) >= limits.interval) {
+            mark(out, delimiter);
+        }
+        return false;
+    }
+
+    finish(out, delimiter);
+
+    last.assign(record, record + n);
+    seen = true;
+
+    return true;
+}
+auto Coalescer::finish(buffer_type& out, char_type const delimiter) -> void
+{
+    if (repeated != 0) {
+        mark(out, delimiter);
+    }
+}
+auto Coalescer::reset() -> void
+{
+    seen     = false;
+    repeated = 0;
+}
+}  // namespace Stream_buffer
@@ -0,0 +1,108 @@
+/*
+ *  Copyright (C) 2020  Marek Marecki
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <string.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+// FIXME do not group custom includes with POSIX and C library includes
+// clang-format off
+#include <stream-buffer/stream-buffer.h>
+// clang-format on
+
+
+namespace Stream_buffer {
+static auto matches(Filter::Pattern const& pattern,
+                    Filter::char_type const* record,
+                    Filter::size_type const n) -> bool
+{
+    auto const& text = pattern.text;
+    if (text.size() > n) {
+        return false;
+    }
+    if (text.empty()) {
+        return true;
+    }
+
+    /*
+     * memmem(3) is vectorised in glibc, and does the first-byte scan with
+     * memchr(3) so most records are rejected without a full comparison.
+     */
+    switch (pattern.anchor) {
+    case Filter::Anchor::Prefix:
+        return (std::memcmp(record, text.data(), text.size()) == 0);
+    case Filter::Anchor::Anywhere:
+    default:
+        return (memmem(record, n, text.data(), text.size()) != nullptr);
+    }
+}
+
+auto Filter::include(std::string text, Anchor const anchor) -> void
+{
+    includes.push_back(Pattern{std::move(text), anchor});
+}
+auto Filter::exclude(std::string text, Anchor const anchor) -> void
+{
+    excludes.push_back(Pattern{std::move(text), anchor});
+}
+auto Filter::empty() const -> bool
+{
+    return (includes.empty() and excludes.empty());
+}
+auto Filter::judge(char_type const* record, size_type const n) -> bool
+{
+    auto const match = [record, n](Pattern const& each) -> bool {
+        return matches(each, record, n);
+    };
+
+    auto const included =
+        includes.empty()
+        or std::any_of(includes.begin(), includes.end(), match);
+    auto const ok =
+        included and std::none_of(excludes.begin(), excludes.end(), match);
+
+    ++(ok ? passed_count : dropped_count);
+    return ok;
+}
+auto Filter::accept(char_type const* record, size_type const n) -> bool
+{
+    if (unfinished.has_value()) {
+        return std::exchange(unfinished, std::nullopt).value();
+    }
+    return judge(record, n);
+}
+auto Filter::accept_partial(char_type const* record, size_type const n)
+    -> bool
+{
+    if (not unfinished.has_value()) {
+        unfinished = judge(record, n);
+    }
+    return *unfinished;
+}
+auto Filter::passed() const -> uint64_t
+{
+    return passed_count;
+}
+auto Filter::dropped() const -> uint64_t
+{
+    return dropped_count;
+}
+}  // namespace Stream_buffer
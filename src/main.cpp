@@ -22,14 +22,18 @@
 #include <unistd.h>
 
 #include <atomic>
+#include <cctype>
+#include <chrono>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
 #include <functional>
 #include <iomanip>
 #include <iostream>
+#include <limits>
 #include <map>
 #include <optional>
+#include <stdexcept>
 #include <string>
 #include <string_view>
 #include <thread>
@@ -86,57 +90,96 @@ static auto help_or_version(int argc, char** argv) -> bool
     return true;
 }
 
+/*
+ * Parse a whole option value as a number not greater than max. Values with
+ * trailing garbage, and negative ones (which strtoull(3) happily wraps around)
+ * are rejected.
+ */
+static auto parse_number(std::string const& s, uint64_t const max)
+    -> std::optional<uint64_t>
+{
+    if (s.empty() or not std::isdigit(static_cast<unsigned char>(s.front()))) {
+        return {};
+    }
+
+    errno        = 0;
+    char* end    = nullptr;
+    auto const n = std::strtoull(s.c_str(), &end, 0);
+    if (errno == ERANGE or *end != '\0' or n > max) {
+        return {};
+    }
+    return n;
+}
+
+/*
+ * The marker interval is used as the epoll_wait(2) timeout, in milliseconds.
+ */
+constexpr auto MAX_COALESCING_INTERVAL =
+    static_cast<uint64_t>(std::numeric_limits<int>::max() / 1000);
+
+/*
+ * Runs of repeated lines get a marker at least once a second, so that a storm
+ * of identical lines does not look like silence.
+ */
+auto const DEFAULT_COALESCING =
+    Coalescer::Limits{0, std::chrono::milliseconds{1000}};
+
 enum class Commands : uint8_t {
     Nop,
     Flush,
     Resize,
 };
 
-static auto flush(std::vector<uint8_t> const buffer, int const to) -> int
-{
-    return write(to, buffer.data(), buffer.size());
-}
-static auto stream_data(Buffer& buffer,
-                        std::optional<char> line_buffered,
-                        int const from,
-                        int const to) -> ssize_t
+static auto stream_data(Stream& stream, int const from) -> ssize_t
 {
-    auto const read_size = read(from, buffer.head(), buffer.left());
+    auto const read_size = read(from, stream.head(), stream.left());
 
     if (read_size == 0) {
         std::cerr << "[buffer] pipe closed\n";
         kill(getpid(), SIGQUIT);
-        flush(buffer.drain(), to);
+        stream.flush();
         return 0;
     }
     if (read_size <= 0) {
         kill(getpid(), SIGQUIT);
-        flush(buffer.drain(), to);
+        stream.flush();
         return -1;
     }
 
-    buffer.grow(read_size);
+    stream.commit(static_cast<Stream::size_type>(read_size));
 
-    if (buffer.full()) {
-        flush(buffer.drain(), to);
-        return read_size;
-    }
+    return read_size;
+}
+static auto merge_data(Stream& stream, Source& source, int const from) -> bool
+{
+    auto const read_size = read(from, source.head(), source.left());
 
-    if (line_buffered.has_value()) {
-        if (auto line = buffer.get_line(*line_buffered); line) {
-            auto line_buf = std::move(*line);
-            line_buf.push_back(*line_buffered);
-            flush(std::move(line_buf), to);
-        }
+    if (read_size == -1 and errno == EAGAIN) {
+        return true;
+    }
+    if (read_size <= 0) {
+        source.finish(stream);
+        return false;
     }
 
-    return read_size;
+    source.commit(static_cast<Source::size_type>(read_size), stream);
+
+    return true;
+}
+static auto report(Stream const& stream) -> void
+{
+    if (auto const& filter = stream.filtered(); filter) {
+        std::cerr << "[buffer] filter: " << filter->passed() << " passed, "
+                  << filter->dropped() << " dropped\n";
+    }
 }
 static auto buffer_loop(std::atomic_bool& sentinel,
                         int const commands_fd,
                         size_t const initial_buffer_size,
                         std::optional<char> const line_buffered,
-                        int const from,
+                        std::optional<Coalescer::Limits> const coalesce,
+                        Filter filter,
+                        std::vector<int> const inputs,
                         int const to) -> void
 {
     /*
@@ -149,7 +192,7 @@ static auto buffer_loop(std::atomic_bool& sentinel,
         kill(getpid(), SIGQUIT);
         return;
     }
-    {
+    for (auto const from : inputs) {
         epoll_event ev;
         ev.events  = EPOLLIN;
         ev.data.fd = from;
@@ -172,11 +215,64 @@ static auto buffer_loop(std::atomic_bool& sentinel,
         }
     }
 
-    auto buffer = Buffer{initial_buffer_size};
+    auto stream = Stream{initial_buffer_size, fd_sink(to)};
+    stream.frame(line_buffered);
+    stream.coalesce(coalesce);
+    stream.filter_by(std::move(filter));
+
+    /*
+     * With more than one input each of them gets its own Source so that only
+     * complete lines reach the shared stream, and lines from different
+     * producers never interleave. A single input is read straight into the
+     * stream.
+     */
+    auto sources = std::map<int, Source>{};
+    if (inputs.size() > 1) {
+        auto const delimiter =
+            static_cast<Source::char_type>(line_buffered.value_or('\n'));
+        for (auto const from : inputs) {
+            sources.emplace(from, Source{initial_buffer_size, delimiter});
+        }
+    }
+
+    /*
+     * A line that does not fit in its Source is passed on in pieces. Until
+     * it ends the stream belongs to the input it came from: the other inputs
+     * are not polled, and their data waits in their pipes.
+     */
+    auto owner        = std::optional<int>{};
+    auto const others = [epoll_fd, &sources](int const fd, int const op) {
+        for (auto const& [from, source] : sources) {
+            if (from == fd) {
+                continue;
+            }
+
+            epoll_event ev;
+            ev.events  = EPOLLIN;
+            ev.data.fd = from;
+            if (epoll_ctl(epoll_fd, op, from, &ev) == -1) {
+                std::cerr << "error: could not modify epoll(7) event for "
+                             "input fd: "
+                          << errno << strerror(errno) << "\n";
+            }
+        }
+    };
+
+    /*
+     * When coalescing, wake up periodically so that a run which went quiet
+     * still gets its marker written.
+     */
+    auto const timeout = (coalesce and coalesce->interval.count() != 0)
+                             ? static_cast<int>(coalesce->interval.count())
+                             : -1;
+
+    auto events = std::vector<epoll_event>(inputs.size() + 1);
     while (not sentinel.load()) {
-        std::array<epoll_event, 2> events;
         auto const nfds =
-            epoll_wait(epoll_fd, events.data(), events.size(), -1);
+            epoll_wait(epoll_fd,
+                       events.data(),
+                       static_cast<int>(events.size()),
+                       timeout);
         if (nfds == -1) {
             auto const saved_errno = errno;
             std::cerr << (
@@ -187,23 +283,19 @@ static auto buffer_loop(std::atomic_bool& sentinel,
             continue;
         }
         if (nfds == 0) {
-            // FIXME isn't this a bug? no fds are ready and yet epoll_wait()
-            // returned?
+            stream.tick();
             continue;
         }
 
-        for (auto i = 0; i < nfds; ++i) {
-            if (events[i].data.fd == from) {
-                auto const res = stream_data(buffer, line_buffered, from, to);
-                if (res <= 0) {
-                    return;
-                }
-            } else if (events[i].data.fd == commands_fd) {
+        auto const ready = static_cast<size_t>(nfds);
+        for (auto i = size_t{0}; i < ready; ++i) {
+            auto const fd = events[i].data.fd;
+            if (fd == commands_fd) {
                 auto command = Commands::Nop;
                 read(commands_fd, &command, 1);
                 switch (command) {
                 case Commands::Flush:
-                    flush(buffer.drain(), to);
+                    stream.flush();
                     break;
                 case Commands::Resize:
                 {
@@ -214,35 +306,105 @@ static auto buffer_loop(std::atomic_bool& sentinel,
                     auto size = uint32_t{};
                     std::memcpy(&size, data.begin() + 1, sizeof(size));
 
-                    flush(buffer.drain(), to);
-
                     auto const new_size =
                         size * static_cast<uint64_t>(UNIT_SIZES.at(unit));
-                    buffer.resize(new_size);
+                    try {
+                        stream.resize(new_size);
+                        for (auto& [from, source] : sources) {
+                            source.resize(new_size);
+                        }
+                    } catch (std::invalid_argument const& e) {
+                        std::cerr << "error: could not resize: " << e.what()
+                                  << "\n";
+                    }
                     break;
                 }
                 case Commands::Nop:
                 default:
                     break;
                 }
+            } else if (sources.empty()) {
+                auto const res = stream_data(stream, fd);
+                if (res <= 0) {
+                    report(stream);
+                    return;
+                }
+            } else if (auto source = sources.find(fd);
+                       source != sources.end()) {
+                if (owner and *owner != fd) {
+                    /*
+                     * Reported together with the owner's data, before the
+                     * other inputs were taken off the poll.
+                     */
+                    continue;
+                }
+
+                auto const open = merge_data(stream, source->second, fd);
+                if (source->second.partial() and not owner) {
+                    owner = fd;
+                    others(fd, EPOLL_CTL_DEL);
+                } else if (owner == fd and not source->second.partial()) {
+                    owner.reset();
+                    others(fd, EPOLL_CTL_ADD);
+                }
+                if (open) {
+                    continue;
+                }
+
+                epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+                close(fd);
+                sources.erase(source);
+
+                if (sources.empty()) {
+                    std::cerr << "[buffer] all pipes closed\n";
+                    kill(getpid(), SIGQUIT);
+                    stream.flush();
+                    report(stream);
+                    return;
+                }
             }
         }
     }
 
     {
         /*
-         * Set the input file descriptor as non-blocking (to avoid hanging) and
-         * attempt to stream one last portion of data; ie, whatever is present
-         * in the pipe.
+         * Set the input file descriptors as non-blocking (to avoid hanging)
+         * and attempt to stream one last portion of data; ie, whatever is
+         * present in the pipes.
          *
          * If an error is encountered at any step just abort the operation!
          * Otherwise you risk hanging the stream-buffer on the read(2) system
          * call and it is surprisingly difficult to get out of that situation.
          */
-        auto const flags = fcntl(from, F_GETFL);
-        if (flags != -1) {
-            if (fcntl(from, F_SETFL, flags | O_NONBLOCK) != -1) {
-                stream_data(buffer, std::nullopt, from, to);
+        auto const non_blocking = [](int const fd) -> bool {
+            auto const flags = fcntl(fd, F_GETFL);
+            return (flags != -1
+                    and fcntl(fd, F_SETFL, flags | O_NONBLOCK) != -1);
+        };
+
+        if (sources.empty()) {
+            if (non_blocking(inputs.front())) {
+                stream_data(stream, inputs.front());
+            }
+        }
+
+        /*
+         * The input in the middle of a long line goes first, so that its
+         * line is not broken by lines of the others.
+         */
+        auto const drain = [&stream, &non_blocking](int const from,
+                                                    Source& source) {
+            if (non_blocking(from)) {
+                merge_data(stream, source, from);
+            }
+            source.finish(stream);
+        };
+        if (owner) {
+            drain(*owner, sources.at(*owner));
+        }
+        for (auto& [from, source] : sources) {
+            if (from != owner) {
+                drain(from, source);
             }
         }
     }
@@ -250,7 +412,8 @@ static auto buffer_loop(std::atomic_bool& sentinel,
     /*
      * Flush whatever data you can before exiting.
      */
-    flush(buffer.drain(), to);
+    stream.flush();
+    report(stream);
 }
 static auto receive_commands(std::atomic_bool& sentinel, int const commands_fd)
     -> void
@@ -311,6 +474,9 @@ auto main(int argc, char** argv) -> int
     }
 
     auto line_buffered   = false;
+    auto coalesce        = std::optional<Coalescer::Limits>{};
+    auto filter          = Filter{};
+    auto inputs          = std::vector<int>{};
     auto line_ending     = '\n';
     auto buffer_size_arg = std::string{"4KiB"};
 
@@ -325,6 +491,104 @@ auto main(int argc, char** argv) -> int
                 line_buffered = true;
                 continue;
             }
+            if (each == "--coalesce") {
+                line_buffered = true;
+                coalesce      = coalesce.value_or(DEFAULT_COALESCING);
+                continue;
+            }
+            if (each.find("--coalesce-every=") == 0) {
+                auto const value =
+                    each.substr(std::string{"--coalesce-every="}.size());
+                auto const every = parse_number(
+                    value, std::numeric_limits<Coalescer::size_type>::max());
+                if (not every) {
+                    std::cerr << "error: invalid repetition count: " << value
+                              << "\n";
+                    return 1;
+                }
+                line_buffered   = true;
+                coalesce        = coalesce.value_or(DEFAULT_COALESCING);
+                coalesce->every = *every;
+                continue;
+            }
+            if (each.find("--coalesce-interval=") == 0) {
+                auto const value =
+                    each.substr(std::string{"--coalesce-interval="}.size());
+                auto const interval =
+                    parse_number(value, MAX_COALESCING_INTERVAL);
+                if (not interval) {
+                    std::cerr << "error: invalid interval: " << value << "\n";
+                    return 1;
+                }
+                line_buffered      = true;
+                coalesce           = coalesce.value_or(DEFAULT_COALESCING);
+                coalesce->interval = std::chrono::seconds{*interval};
+                continue;
+            }
+            if (each.find("--input=") == 0) {
+                /*
+                 * Open without blocking so that a FIFO without a writer does
+                 * not stall the startup, and then switch the descriptor to
+                 * blocking mode to treat it the same as the standard input.
+                 */
+                auto const path =
+                    each.substr(std::string{"--input="}.size());
+                auto const fd = open(path.c_str(), O_RDONLY | O_NONBLOCK);
+                if (fd == -1
+                    or fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK)
+                           == -1) {
+                    std::cerr << "error: could not open input " << path << ": "
+                              << strerror(errno) << "\n";
+                    return 1;
+                }
+                inputs.push_back(fd);
+                continue;
+            }
+            if (each.find("--input-fd=") == 0) {
+                auto const value =
+                    each.substr(std::string{"--input-fd="}.size());
+                auto const number = parse_number(
+                    value,
+                    static_cast<uint64_t>(std::numeric_limits<int>::max()));
+                if (not number) {
+                    std::cerr << "error: invalid input fd: " << value << "\n";
+                    return 1;
+                }
+                auto const fd = static_cast<int>(*number);
+                if (fcntl(fd, F_GETFD) == -1) {
+                    std::cerr << "error: invalid input fd " << fd << ": "
+                              << strerror(errno) << "\n";
+                    return 1;
+                }
+                inputs.push_back(fd);
+                continue;
+            }
+            if (each.find("--include=") == 0) {
+                line_buffered = true;
+                filter.include(each.substr(std::string{"--include="}.size()),
+                               Filter::Anchor::Anywhere);
+                continue;
+            }
+            if (each.find("--include-prefix=") == 0) {
+                line_buffered = true;
+                filter.include(
+                    each.substr(std::string{"--include-prefix="}.size()),
+                    Filter::Anchor::Prefix);
+                continue;
+            }
+            if (each.find("--exclude=") == 0) {
+                line_buffered = true;
+                filter.exclude(each.substr(std::string{"--exclude="}.size()),
+                               Filter::Anchor::Anywhere);
+                continue;
+            }
+            if (each.find("--exclude-prefix=") == 0) {
+                line_buffered = true;
+                filter.exclude(
+                    each.substr(std::string{"--exclude-prefix="}.size()),
+                    Filter::Anchor::Prefix);
+                continue;
+            }
         }
         if (i < argc) {
             buffer_size_arg = argv[i];
@@ -338,6 +602,10 @@ auto main(int argc, char** argv) -> int
         return 1;
     }
     auto const initial_buffer_size = parse_buffer_size(buffer_size_arg);
+    if (initial_buffer_size == 0 and (coalesce or not filter.empty())) {
+        std::cerr << "error: cannot filter or coalesce without a buffer\n";
+        return 1;
+    }
 
     {
         sigset_t mask;
@@ -378,7 +646,9 @@ auto main(int argc, char** argv) -> int
             read_end,
             initial_buffer_size,
             (line_buffered ? std::optional<char>{line_ending} : std::nullopt),
-            0,
+            coalesce,
+            std::move(filter),
+            (inputs.empty() ? std::vector<int>{0} : std::move(inputs)),
             1};
         auto controller =
             std::thread{receive_commands, std::ref(sentinel), write_end};
@@ -0,0 +1,102 @@
+/*
+ *  Copyright (C) 2020  Marek Marecki
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+// FIXME do not group custom includes with POSIX and C library includes
+// clang-format off
+#include <stream-buffer/stream-buffer.h>
+// clang-format on
+
+
+namespace Stream_buffer {
+Source::Source(size_type const sz, char_type const d)
+        : pending{sz}
+        , delimiter{d}
+{}
+auto Source::left() const -> size_type
+{
+    return pending.left();
+}
+auto Source::head() -> char_type*
+{
+    return pending.head();
+}
+auto Source::partial() const -> bool
+{
+    return unfinished;
+}
+auto Source::forward(size_type const n, Stream& stream) -> ssize_t
+{
+    auto const res = stream.append(pending.data(), n);
+    pending.consume(n);
+    return res;
+}
+auto Source::commit(size_type const n, Stream& stream) -> ssize_t
+{
+    pending.grow(n);
+
+    auto res = ssize_t{0};
+    auto const from = pending.size() - n;
+    if (auto const pos = pending.find_last(delimiter, from); pos) {
+        res        = forward(*pos + 1, stream);
+        unfinished = false;
+    }
+    if (res >= 0 and pending.full()) {
+        /*
+         * The record does not fit. Pass on what there is of it; the rest
+         * follows as more data arrives.
+         */
+        res        = forward(pending.size(), stream);
+        unfinished = true;
+    }
+
+    return res;
+}
+auto Source::finish(Stream& stream) -> ssize_t
+{
+    if (pending.size() == 0 and not unfinished) {
+        return 0;
+    }
+
+    /*
+     * Terminate a record the producer left unfinished, so that a record of
+     * another producer does not get glued to it.
+     */
+    auto res = forward(pending.size(), stream);
+    if (res >= 0) {
+        auto const sent = stream.append(&delimiter, 1);
+        res             = (sent < 0) ? sent : (res + sent);
+    }
+    unfinished = false;
+    return res;
+}
+auto Source::resize(size_type const n) -> void
+{
+    /*
+     * What is pending is kept. If it does not fit in the new size, there is
+     * room left for one more byte and the next commit() passes the record on
+     * in pieces, as any other record that does not fit.
+     */
+    auto const kept =
+        Buffer::buffer_type(pending.data(), pending.data() + pending.size());
+    pending.resize(std::max(n, kept.size() + 1));
+    std::memcpy(pending.head(), kept.data(), kept.size());
+    pending.grow(kept.size());
+}
+}  // namespace Stream_buffer
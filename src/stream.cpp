@@ -0,0 +1,337 @@
+/*
+ *  Copyright (C) 2020  Marek Marecki
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <errno.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+// FIXME do not group custom includes with POSIX and C library includes
+// clang-format off
+#include <stream-buffer/stream-buffer.h>
+// clang-format on
+
+
+namespace Stream_buffer {
+Stream::Stream(size_type const sz, sink_type s)
+        : buffer{sz}
+        , sink{std::move(s)}
+{}
+auto Stream::sink_to(sink_type s) -> void
+{
+    sink = std::move(s);
+}
+auto Stream::frame(std::optional<char_type> const d) -> void
+{
+    delimiter = d;
+}
+auto Stream::coalesce(std::optional<Coalescer::Limits> const limits) -> void
+{
+    /*
+     * Keep the state of a run that is in progress; only turning coalescing
+     * off ends it, and even then its marker is not lost.
+     */
+    if (limits.has_value()) {
+        if (capacity() == 0) {
+            throw std::invalid_argument{"cannot coalesce without a buffer"};
+        }
+        if (coalescer) {
+            coalescer->limit(*limits);
+        } else {
+            coalescer.emplace(*limits);
+        }
+        return;
+    }
+
+    tick();
+    coalescer.reset();
+}
+auto Stream::filter_by(std::optional<Filter> f) -> void
+{
+    if (f.has_value() and f->empty()) {
+        f.reset();
+    }
+    if (f.has_value() and capacity() == 0) {
+        throw std::invalid_argument{"cannot filter without a buffer"};
+    }
+    filter = std::move(f);
+}
+auto Stream::filtered() const -> std::optional<Filter> const&
+{
+    return filter;
+}
+auto Stream::left() const -> size_type
+{
+    return buffer.left();
+}
+auto Stream::size() const -> size_type
+{
+    return buffer.size();
+}
+auto Stream::capacity() const -> size_type
+{
+    return (buffer.size() + buffer.left());
+}
+auto Stream::head() -> char_type*
+{
+    return buffer.head();
+}
+auto Stream::deliver(char_type const* data, size_type const n) -> ssize_t
+{
+    if (not sink) {
+        return static_cast<ssize_t>(n);
+    }
+
+    /*
+     * A sink may consume less than it was given. Hand it the rest until it
+     * takes everything or fails; a sink that consumes nothing is treated as
+     * failed so that it cannot stall the stream.
+     */
+    auto delivered = size_type{0};
+    while (delivered < n) {
+        auto const res = sink(data + delivered, n - delivered);
+        if (res == 0) {
+            errno = EIO;
+            return -1;
+        }
+        if (res < 0) {
+            return -1;
+        }
+        delivered += static_cast<size_type>(res);
+    }
+    return static_cast<ssize_t>(delivered);
+}
+auto Stream::emit(size_type const n) -> ssize_t
+{
+    if (n == 0) {
+        return 0;
+    }
+
+    auto const res = deliver(buffer.data(), n);
+    buffer.consume(n);
+    return res;
+}
+auto Stream::emit_output() -> ssize_t
+{
+    if (output.empty()) {
+        return 0;
+    }
+
+    return deliver(output.data(), output.size());
+}
+auto Stream::processed() const -> bool
+{
+    return (delimiter and (filter or coalescer));
+}
+auto Stream::process(size_type const n) -> ssize_t
+{
+    /*
+     * Run complete records in the [0, n) range through the filter and the
+     * coalescer. Records that survive are moved together in place and written
+     * straight from the buffer, so they are not copied anywhere else. Only the
+     * coalescer markers, which go in between them, are written from the output
+     * buffer.
+     */
+    auto const data = buffer.data();
+    auto const d    = *delimiter;
+
+    auto res        = ssize_t{0};
+    auto const send = [this, &res](char_type const* p, size_type const len) {
+        if (res < 0 or len == 0) {
+            return;
+        }
+        auto const sent = deliver(p, len);
+        res             = (sent < 0) ? sent : (res + sent);
+    };
+
+    /*
+     * Survivors that were not written yet are in the [start, kept) range.
+     */
+    auto start = size_type{0};
+    auto kept  = size_type{0};
+    auto begin = size_type{0};
+    while (begin < n) {
+        auto const end =
+            static_cast<size_type>(std::find(data + begin, data + n, d) - data);
+        auto const record = data + begin;
+        auto const length = end - begin;
+        auto const next   = end + 1;
+
+        /*
+         * The first record may be the tail of one that was flushed in pieces.
+         * It shares the verdict of its head, and is kept out of the coalescer
+         * as it is not a whole record.
+         */
+        auto const tail = std::exchange(broken, false);
+
+        auto keep = (not filter or filter->accept(record, length));
+        if (keep and coalescer and not tail) {
+            output.clear();
+            keep = coalescer->feed(record, length, output, d);
+            if (not output.empty()) {
+                send(data + start, kept - start);
+                send(output.data(), output.size());
+                start = kept = begin;
+            }
+        }
+        if (keep) {
+            if (kept != begin) {
+                std::memmove(data + kept, record, next - begin);
+            }
+            kept += (next - begin);
+        }
+
+        begin = next;
+    }
+    send(data + start, kept - start);
+
+    return res;
+}
+auto Stream::records(size_type const n) -> ssize_t
+{
+    if (not processed()) {
+        return emit(n);
+    }
+
+    auto const res = process(n);
+    buffer.consume(n);
+    return res;
+}
+auto Stream::commit(size_type const n) -> ssize_t
+{
+    buffer.grow(n);
+
+    /*
+     * Complete records are flushed as soon as they are committed, so there
+     * is no delimiter in what was in the buffer before.
+     */
+    auto res = ssize_t{0};
+    if (delimiter.has_value()) {
+        auto const from = buffer.size() - n;
+        if (auto const pos = buffer.find_last(*delimiter, from); pos) {
+            res = records(*pos + 1);
+        }
+    }
+
+    /*
+     * In line mode the buffer can only stay full if a single record does not
+     * fit in it. There is no choice but to break such a record.
+     */
+    if (res >= 0 and buffer.full()) {
+        res = flush();
+    }
+
+    return res;
+}
+auto Stream::append(char_type const* data, size_type const n) -> ssize_t
+{
+    if (capacity() == 0) {
+        /*
+         * An unbuffered stream. Pass the data straight to the sink instead of
+         * spinning on an always-full buffer.
+         */
+        return deliver(data, n);
+    }
+
+    auto appended = size_type{0};
+    while (appended < n) {
+        auto const chunk = std::min(n - appended, buffer.left());
+        std::memcpy(buffer.head(), data + appended, chunk);
+        appended += chunk;
+
+        if (commit(chunk) < 0) {
+            return -1;
+        }
+    }
+    return static_cast<ssize_t>(appended);
+}
+auto Stream::flush() -> ssize_t
+{
+    if (not processed()) {
+        return emit(buffer.size());
+    }
+
+    auto const pos      = buffer.find_last(*delimiter, 0);
+    auto const complete = pos ? (*pos + 1) : size_type{0};
+
+    auto res = process(complete);
+    if (res >= 0 and coalescer) {
+        output.clear();
+        coalescer->finish(output, *delimiter);
+        auto const sent = emit_output();
+        res             = (sent < 0) ? sent : (res + sent);
+    }
+
+    auto const partial = buffer.data() + complete;
+    auto const length  = buffer.size() - complete;
+    if (length != 0) {
+        if (not filter or filter->accept_partial(partial, length)) {
+            /*
+             * A partial record breaks the run, as there is no telling what
+             * its tail will look like.
+             */
+            if (coalescer) {
+                coalescer->reset();
+            }
+            if (res >= 0) {
+                auto const sent = deliver(partial, length);
+                res             = (sent < 0) ? sent : (res + sent);
+            }
+        }
+        broken = true;
+    }
+    buffer.clear();
+
+    return res;
+}
+auto Stream::tick() -> ssize_t
+{
+    if (not (coalescer and delimiter)) {
+        return 0;
+    }
+
+    output.clear();
+    coalescer->finish(output, *delimiter);
+    return emit_output();
+}
+auto Stream::resize(size_type const n) -> ssize_t
+{
+    if (n == 0 and (filter or coalescer)) {
+        throw std::invalid_argument{
+            "cannot filter or coalesce without a buffer"};
+    }
+
+    auto const res = flush();
+    buffer.resize(n);
+    return res;
+}
+
+auto fd_sink(int const fd) -> Stream::sink_type
+{
+    return [fd](Stream::char_type const* data,
+                Stream::size_type const n) -> ssize_t {
+        auto res = write(fd, data, n);
+        while (res == -1 and errno == EINTR) {
+            res = write(fd, data, n);
+        }
+        return res;
+    };
+}
+}  // namespace Stream_buffer